@@ -28,9 +28,48 @@
 
 #include <vector>
 #include <atomic>
+#include <mutex>
 
 namespace itk
 {
+/** \class BoneMorphometryFeaturesFilterEnums
+ * \brief Contains all enum classes used by the BoneMorphometryFeaturesFilter class.
+ * \ingroup BoneMorphometry
+ */
+class BoneMorphometryFeaturesFilterEnums
+{
+public:
+  /** \class ThresholdMethod
+   * \ingroup BoneMorphometry
+   * Method used to choose the threshold separating the bone from the rest of the scan.
+   */
+  enum class ThresholdMethod : uint8_t
+  {
+    Fixed,
+    Otsu,
+    Percentile
+  };
+};
+
+/** Define how to print enumeration values. */
+inline std::ostream &
+operator<<(std::ostream & out, const BoneMorphometryFeaturesFilterEnums::ThresholdMethod value)
+{
+  return out << [value] {
+    switch (value)
+    {
+      case BoneMorphometryFeaturesFilterEnums::ThresholdMethod::Fixed:
+        return "itk::BoneMorphometryFeaturesFilterEnums::ThresholdMethod::Fixed";
+      case BoneMorphometryFeaturesFilterEnums::ThresholdMethod::Otsu:
+        return "itk::BoneMorphometryFeaturesFilterEnums::ThresholdMethod::Otsu";
+      case BoneMorphometryFeaturesFilterEnums::ThresholdMethod::Percentile:
+        return "itk::BoneMorphometryFeaturesFilterEnums::ThresholdMethod::Percentile";
+      default:
+        return "INVALID VALUE FOR itk::BoneMorphometryFeaturesFilterEnums::ThresholdMethod";
+    }
+  }();
+}
+
 /** \class BoneMorphometryFeaturesFilter
  * \brief Compute the percent bone volume [BVTV], trabecular thickness [TbTh], trabecular separation [TbSp] trabecular
  * number [TbN] and Bone Surface to Bone Volume ratio [BSBV]
@@ -49,6 +88,20 @@ namespace itk
  * threaded. It computes metrics in each thread then combines them in
  * its AfterThreadedGenerate method.
  *
+ * When ComputeProfile is on, the same counters are also binned along ProfileAxis into bands of
+ * ProfileBandWidth slices, during the same pass. The per-band metrics are then available through
+ * the Get*Profile() methods, band 0 starting at the first slice of the requested region. The last band is
+ * shorter when ProfileBandWidth does not divide the number of slices. Unlike running the filter on a crop of
+ * the band, the voxels on the faces of a band see their neighbors in the adjacent bands. A band with no voxel
+ * inside the mask yields NaN metrics.
+ *
+ * Instead of a fixed threshold, the threshold can be chosen automatically from the histogram of the
+ * intensities inside the mask, with either Otsu's method or a percentile of the intensities (ThresholdMethod).
+ * The histogram is built in a threaded pass before the morphometry pass, after a cheap pass computing its
+ * range, and the chosen threshold is reported by GetComputedThreshold(). When the mask is empty, or when all the
+ * intensities inside the mask are equal, there is nothing to separate: a warning is emitted and Threshold is used
+ * as is.
+ *
  * \author: Jean-Baptiste Vimort
  * \ingroup BoneMorphometry
  *
@@ -98,8 +151,40 @@ public:
   itkSetMacro(Threshold, RealType);
   itkGetMacro(Threshold, RealType);
 
+  /** Methods to set/get how the threshold is chosen. Fixed uses Threshold as is. */
+  using ThresholdMethodEnum = BoneMorphometryFeaturesFilterEnums::ThresholdMethod;
+  itkSetEnumMacro(ThresholdMethod, ThresholdMethodEnum);
+  itkGetEnumMacro(ThresholdMethod, ThresholdMethodEnum);
+
+  /** Methods to set/get the number of bins, at least 2, of the histogram used by the automatic threshold methods */
+  itkSetClampMacro(NumberOfHistogramBins, unsigned int, 2, NumericTraits<unsigned int>::max());
+  itkGetConstMacro(NumberOfHistogramBins, unsigned int);
+
+  /** Methods to set/get the percentile, between 0 and 100, used as threshold by the Percentile method */
+  itkSetClampMacro(ThresholdPercentile, double, 0.0, 100.0);
+  itkGetConstMacro(ThresholdPercentile, double);
+
+  /** Method to get the threshold used by the last update: Threshold with the Fixed method, otherwise the threshold
+   * chosen by Otsu's method or the percentile. The automatic methods fall back to Threshold when the mask is empty
+   * or when the intensities inside the mask are constant. */
+  itkGetConstMacro(ComputedThreshold, RealType);
+
+  /** Methods to set/get whether the metrics are also computed per band along ProfileAxis */
+  itkSetMacro(ComputeProfile, bool);
+  itkGetConstMacro(ComputeProfile, bool);
+  itkBooleanMacro(ComputeProfile);
+
+  /** Methods to set/get the image axis along which the profile is computed */
+  itkSetClampMacro(ProfileAxis, unsigned int, 0, TInputImage::ImageDimension - 1);
+  itkGetConstMacro(ProfileAxis, unsigned int);
+
+  /** Methods to set/get the number of slices grouped in each band of the profile */
+  itkSetClampMacro(ProfileBandWidth, SizeValueType, 1, NumericTraits<SizeValueType>::max());
+  itkGetConstMacro(ProfileBandWidth, SizeValueType);
+
   /** Methods to get the mask different outputs */
   using RealTypeDecoratedType = SimpleDataObjectDecorator<RealType>;
+  using RealArrayType = std::vector<RealType>;
 
   RealType
   GetBVTV()
@@ -166,6 +251,58 @@ public:
     return decoratedBSBV.GetPointer();
   }
 
+  /** Methods to get the per band outputs, empty unless ComputeProfile is on */
+  SizeValueType
+  GetNumberOfProfileBands() const
+  {
+    return static_cast<SizeValueType>(m_PpProfile.size());
+  }
+
+  RealArrayType
+  GetBVTVProfile() const
+  {
+    return m_PpProfile;
+  }
+
+  RealArrayType
+  GetTbNProfile() const
+  {
+    return m_PlProfile;
+  }
+
+  RealArrayType
+  GetTbThProfile() const
+  {
+    RealArrayType profile(m_PpProfile.size());
+    for (size_t band = 0; band < profile.size(); ++band)
+    {
+      profile[band] = m_PpProfile[band] / m_PlProfile[band];
+    }
+    return profile;
+  }
+
+  RealArrayType
+  GetTbSpProfile() const
+  {
+    RealArrayType profile(m_PpProfile.size());
+    for (size_t band = 0; band < profile.size(); ++band)
+    {
+      profile[band] = (1.0 - m_PpProfile[band]) / m_PlProfile[band];
+    }
+    return profile;
+  }
+
+  RealArrayType
+  GetBSBVProfile() const
+  {
+    RealArrayType profile(m_PpProfile.size());
+    for (size_t band = 0; band < profile.size(); ++band)
+    {
+      profile[band] = 2.0 * (m_PlProfile[band] / m_PpProfile[band]);
+    }
+    return profile;
+  }
+
 #ifdef ITK_USE_CONCEPT_CHECKING
   // Begin concept checking
   itkConceptMacro(InputPixelDimensionCheck, (Concept::SameDimension<TInputImage::ImageDimension, 3u>));
@@ -183,6 +320,10 @@ protected:
   void
   AllocateOutputs() override;
 
+  /** Choose the threshold according to ThresholdMethod, in threaded passes over the input. */
+  void
+  ComputeThreshold();
+
   /** Initialize some accumulators before the threads run. */
   void
   BeforeThreadedGenerateData() override;
@@ -199,10 +340,44 @@ protected:
   PrintSelf(std::ostream & os, Indent indent) const override;
 
 private:
+  /** Counters accumulated over the whole region, or over one band of the profile. */
+  struct Counters
+  {
+    SizeValueType numVoxelsInsideMask{ 0 };
+    SizeValueType numBoneVoxels{ 0 };
+    SizeValueType numX{ 0 };
+    SizeValueType numY{ 0 };
+    SizeValueType numZ{ 0 };
+    SizeValueType numXO{ 0 };
+    SizeValueType numYO{ 0 };
+    SizeValueType numZO{ 0 };
+
+    Counters &
+    operator+=(const Counters & other)
+    {
+      numVoxelsInsideMask += other.numVoxelsInsideMask;
+      numBoneVoxels += other.numBoneVoxels;
+      numX += other.numX;
+      numY += other.numY;
+      numZ += other.numZ;
+      numXO += other.numXO;
+      numYO += other.numYO;
+      numZO += other.numZO;
+      return *this;
+    }
+  };
+
   // Inputs
-  RealType m_Threshold;
+  RealType            m_Threshold;
+  ThresholdMethodEnum m_ThresholdMethod;
+  unsigned int        m_NumberOfHistogramBins;
+  double              m_ThresholdPercentile;
+  bool                m_ComputeProfile;
+  unsigned int        m_ProfileAxis;
+  SizeValueType       m_ProfileBandWidth;
 
   // Internal computation
+  RealType m_ComputedThreshold;
   RealType m_Pp;
   RealType m_Pl;
   RealType m_PlX;
@@ -218,6 +393,13 @@ private:
   std::atomic<SizeValueType> m_NumYO;
   std::atomic<SizeValueType> m_NumZO;
 
+  // Profile computation
+  IndexValueType        m_ProfileStartIndex;
+  std::vector<Counters> m_ProfileCounters;
+  std::mutex            m_ProfileMutex;
+  RealArrayType         m_PpProfile;
+  RealArrayType         m_PlProfile;
+
 }; // end of class
 } // end namespace itk
 
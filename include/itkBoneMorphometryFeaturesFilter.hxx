@@ -22,17 +22,30 @@
 #include "itkImageScanlineIterator.h"
 #include "itkProgressReporter.h"
 #include "itkNeighborhoodAlgorithm.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkOtsuThresholdCalculator.h"
+#include "itkMath.h"
+
+#include <algorithm>
 
 namespace itk
 {
 template <typename TInputImage, typename TMaskImage>
 BoneMorphometryFeaturesFilter<TInputImage, TMaskImage>::BoneMorphometryFeaturesFilter()
   : m_Threshold(1)
+  , m_ThresholdMethod(ThresholdMethodEnum::Fixed)
+  , m_NumberOfHistogramBins(256)
+  , m_ThresholdPercentile(50.0)
+  , m_ComputeProfile(false)
+  , m_ProfileAxis(TInputImage::ImageDimension - 1)
+  , m_ProfileBandWidth(1)
+  , m_ComputedThreshold(1)
   , m_Pp(0)
   , m_Pl(0)
   , m_PlX(0)
   , m_PlY(0)
   , m_PlZ(0)
+  , m_ProfileStartIndex(0)
 {
   this->SetNumberOfRequiredInputs(1);
 }
@@ -49,10 +62,148 @@ BoneMorphometryFeaturesFilter<TInputImage, TMaskImage>::AllocateOutputs()
   // Nothing that needs to be allocated for the remaining outputs
 }
 
+template <typename TInputImage, typename TMaskImage>
+void
+BoneMorphometryFeaturesFilter<TInputImage, TMaskImage>::ComputeThreshold()
+{
+  if (m_ThresholdMethod == ThresholdMethodEnum::Fixed)
+  {
+    m_ComputedThreshold = m_Threshold;
+    return;
+  }
+
+  const TInputImage * input = this->GetInput();
+  const TMaskImage *  mask = this->GetMaskImage();
+  const RegionType    requestedRegion = this->GetOutput()->GetRequestedRegion();
+  std::mutex          mutex;
+
+  MultiThreaderBase * multiThreader = this->GetMultiThreader();
+  multiThreader->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+
+  // First pass: range of the intensities inside the mask
+  RealType minimum = NumericTraits<RealType>::max();
+  RealType maximum = NumericTraits<RealType>::NonpositiveMin();
+  multiThreader->template ParallelizeImageRegion<TInputImage::ImageDimension>(
+    requestedRegion,
+    [&](const RegionType & regionForThread) {
+      RealType threadMinimum = NumericTraits<RealType>::max();
+      RealType threadMaximum = NumericTraits<RealType>::NonpositiveMin();
+
+      ImageRegionConstIterator<TInputImage> inputIt(input, regionForThread);
+      ImageRegionConstIterator<TMaskImage>  maskIt;
+      if (mask)
+      {
+        maskIt = ImageRegionConstIterator<TMaskImage>(mask, regionForThread);
+      }
+      for (; !inputIt.IsAtEnd(); ++inputIt)
+      {
+        if (mask)
+        {
+          const bool outsideMask = maskIt.Get() == 0;
+          ++maskIt;
+          if (outsideMask)
+          {
+            continue;
+          }
+        }
+        const RealType value = inputIt.Get();
+        threadMinimum = std::min(threadMinimum, value);
+        threadMaximum = std::max(threadMaximum, value);
+      }
+
+      const std::lock_guard<std::mutex> lock(mutex);
+      minimum = std::min(minimum, threadMinimum);
+      maximum = std::max(maximum, threadMaximum);
+    },
+    nullptr);
+
+  if (minimum > maximum)
+  {
+    itkWarningMacro(<< "No voxel inside the mask, the threshold is not computed and Threshold is used instead.");
+    m_ComputedThreshold = m_Threshold;
+    return;
+  }
+  if (Math::ExactlyEquals(minimum, maximum))
+  {
+    itkWarningMacro(<< "Constant intensity " << minimum
+                    << " inside the mask, the threshold is not computed and Threshold is used instead.");
+    m_ComputedThreshold = m_Threshold;
+    return;
+  }
+
+  // Second pass: histogram of the intensities inside the mask, accumulated per work unit
+  const unsigned int         numberOfBins = m_NumberOfHistogramBins;
+  const RealType             binScale = numberOfBins / (maximum - minimum);
+  std::vector<SizeValueType> frequencies(numberOfBins, 0);
+  multiThreader->template ParallelizeImageRegion<TInputImage::ImageDimension>(
+    requestedRegion,
+    [&](const RegionType & regionForThread) {
+      std::vector<SizeValueType> threadFrequencies(numberOfBins, 0);
+
+      ImageRegionConstIterator<TInputImage> inputIt(input, regionForThread);
+      ImageRegionConstIterator<TMaskImage>  maskIt;
+      if (mask)
+      {
+        maskIt = ImageRegionConstIterator<TMaskImage>(mask, regionForThread);
+      }
+      for (; !inputIt.IsAtEnd(); ++inputIt)
+      {
+        if (mask)
+        {
+          const bool outsideMask = maskIt.Get() == 0;
+          ++maskIt;
+          if (outsideMask)
+          {
+            continue;
+          }
+        }
+        const auto bin = static_cast<unsigned int>((inputIt.Get() - minimum) * binScale);
+        ++threadFrequencies[std::min(bin, numberOfBins - 1)];
+      }
+
+      const std::lock_guard<std::mutex> lock(mutex);
+      for (unsigned int bin = 0; bin < numberOfBins; ++bin)
+      {
+        frequencies[bin] += threadFrequencies[bin];
+      }
+    },
+    nullptr);
+
+  using HistogramType = Statistics::Histogram<RealType>;
+  auto                                          histogram = HistogramType::New();
+  typename HistogramType::SizeType              size(1);
+  typename HistogramType::MeasurementVectorType lowerBound(1);
+  typename HistogramType::MeasurementVectorType upperBound(1);
+  size.Fill(numberOfBins);
+  lowerBound.Fill(minimum);
+  upperBound.Fill(maximum);
+  histogram->SetMeasurementVectorSize(1);
+  histogram->Initialize(size, lowerBound, upperBound);
+  for (unsigned int bin = 0; bin < numberOfBins; ++bin)
+  {
+    histogram->SetFrequency(bin, frequencies[bin]);
+  }
+
+  if (m_ThresholdMethod == ThresholdMethodEnum::Otsu)
+  {
+    using CalculatorType = OtsuThresholdCalculator<HistogramType, RealType>;
+    auto calculator = CalculatorType::New();
+    calculator->SetInput(histogram);
+    calculator->Update();
+    m_ComputedThreshold = calculator->GetThreshold();
+  }
+  else
+  {
+    m_ComputedThreshold = histogram->Quantile(0, m_ThresholdPercentile / 100.0);
+  }
+}
+
 template <typename TInputImage, typename TMaskImage>
 void
 BoneMorphometryFeaturesFilter<TInputImage, TMaskImage>::BeforeThreadedGenerateData()
 {
+  this->ComputeThreshold();
+
   m_Pp = 0;
   m_Pl = 0;
   m_PlX = 0;
@@ -68,6 +219,18 @@ BoneMorphometryFeaturesFilter<TInputImage, TMaskImage>::BeforeThreadedGenerateDa
   m_NumXO.store(0);
   m_NumYO.store(0);
   m_NumZO.store(0);
+
+  // Initialize the profile bands covering the requested region
+  m_ProfileCounters.clear();
+  m_PpProfile.clear();
+  m_PlProfile.clear();
+  if (m_ComputeProfile)
+  {
+    const RegionType    requestedRegion = this->GetOutput()->GetRequestedRegion();
+    const SizeValueType numSlices = requestedRegion.GetSize(m_ProfileAxis);
+    m_ProfileStartIndex = requestedRegion.GetIndex(m_ProfileAxis);
+    m_ProfileCounters.resize((numSlices + m_ProfileBandWidth - 1) / m_ProfileBandWidth);
+  }
 }
 
 template <typename TInputImage, typename TMaskImage>
@@ -89,6 +252,21 @@ BoneMorphometryFeaturesFilter<TInputImage, TMaskImage>::AfterThreadedGenerateDat
   m_PlY = ((numY + numYO) / 2.0) / (numVoxelsInsideMask * inSpacing[1]) * 2;
   m_PlZ = ((numZ + numZO) / 2.0) / (numVoxelsInsideMask * inSpacing[2]) * 2;
   m_Pl = (m_PlX + m_PlY + m_PlZ) / 3.0;
+
+  m_PpProfile.resize(m_ProfileCounters.size());
+  m_PlProfile.resize(m_ProfileCounters.size());
+  for (size_t band = 0; band < m_ProfileCounters.size(); ++band)
+  {
+    const Counters & counters = m_ProfileCounters[band];
+    const RealType   plX =
+      ((counters.numX + counters.numXO) / 2.0) / (counters.numVoxelsInsideMask * inSpacing[0]) * 2;
+    const RealType plY =
+      ((counters.numY + counters.numYO) / 2.0) / (counters.numVoxelsInsideMask * inSpacing[1]) * 2;
+    const RealType plZ =
+      ((counters.numZ + counters.numZO) / 2.0) / (counters.numVoxelsInsideMask * inSpacing[2]) * 2;
+    m_PpProfile[band] = counters.numBoneVoxels / static_cast<RealType>(counters.numVoxelsInsideMask);
+    m_PlProfile[band] = (plX + plY + plZ) / 3.0;
+  }
 }
 
 template <typename TInputImage, typename TMaskImage>
@@ -105,14 +283,18 @@ BoneMorphometryFeaturesFilter<TInputImage, TMaskImage>::DynamicThreadedGenerateD
   NeighborhoodOffsetType offsetZ = { { 1, 0, 0 } };
   NeighborhoodOffsetType offsetZO = { { -1, 0, 0 } };
 
-  SizeValueType numVoxelsInsideMask = 0;
-  SizeValueType numBoneVoxels = 0;
-  SizeValueType numX = 0;
-  SizeValueType numY = 0;
-  SizeValueType numZ = 0;
-  SizeValueType numXO = 0;
-  SizeValueType numYO = 0;
-  SizeValueType numZO = 0;
+  const RealType       threshold = m_ComputedThreshold;
+  const bool           computeProfile = m_ComputeProfile;
+  const unsigned int   profileAxis = m_ProfileAxis;
+  const IndexValueType profileStartIndex = m_ProfileStartIndex;
+  const SizeValueType  profileBandWidth = m_ProfileBandWidth;
+
+  // The counters of the current band are accumulated locally, and only flushed to the band counters when the
+  // band changes, so that the loop costs the same with and without a profile.
+  Counters              counters;
+  Counters              totalCounters;
+  SizeValueType         currentBand = 0;
+  std::vector<Counters> bandCounters(computeProfile ? m_ProfileCounters.size() : 0);
 
   MaskImagePointer maskPointer = TMaskImage::New();
   maskPointer = const_cast<TMaskImage *>(this->GetMaskImage());
@@ -137,36 +319,49 @@ BoneMorphometryFeaturesFilter<TInputImage, TMaskImage>::DynamicThreadedGenerateD
         continue;
       }
 
-      ++numVoxelsInsideMask;
+      if (computeProfile)
+      {
+        const SizeValueType band =
+          static_cast<SizeValueType>(inputNIt.GetIndex()[profileAxis] - profileStartIndex) / profileBandWidth;
+        if (band != currentBand)
+        {
+          bandCounters[currentBand] += counters;
+          totalCounters += counters;
+          counters = Counters();
+          currentBand = band;
+        }
+      }
+
+      ++counters.numVoxelsInsideMask;
 
-      if (inputNIt.GetCenterPixel() >= m_Threshold)
+      if (inputNIt.GetCenterPixel() >= threshold)
       {
 
-        ++numBoneVoxels;
+        ++counters.numBoneVoxels;
 
-        if (inputNIt.GetPixel(offsetX) < m_Threshold)
+        if (inputNIt.GetPixel(offsetX) < threshold)
         {
-          ++numXO;
+          ++counters.numXO;
         }
-        if (inputNIt.GetPixel(offsetXO) < m_Threshold)
+        if (inputNIt.GetPixel(offsetXO) < threshold)
         {
-          ++numX;
+          ++counters.numX;
         }
-        if (inputNIt.GetPixel(offsetY) < m_Threshold)
+        if (inputNIt.GetPixel(offsetY) < threshold)
         {
-          ++numYO;
+          ++counters.numYO;
         }
-        if (inputNIt.GetPixel(offsetYO) < m_Threshold)
+        if (inputNIt.GetPixel(offsetYO) < threshold)
         {
-          ++numY;
+          ++counters.numY;
         }
-        if (inputNIt.GetPixel(offsetZ) < m_Threshold)
+        if (inputNIt.GetPixel(offsetZ) < threshold)
         {
-          ++numZO;
+          ++counters.numZO;
         }
-        if (inputNIt.GetPixel(offsetZO) < m_Threshold)
+        if (inputNIt.GetPixel(offsetZO) < threshold)
         {
-          ++numZ;
+          ++counters.numZ;
         }
       }
 
@@ -174,14 +369,29 @@ BoneMorphometryFeaturesFilter<TInputImage, TMaskImage>::DynamicThreadedGenerateD
     }
   }
 
-  m_NumVoxelsInsideMask.fetch_add(numVoxelsInsideMask, std::memory_order_relaxed);
-  m_NumBoneVoxels.fetch_add(numBoneVoxels, std::memory_order_relaxed);
-  m_NumX.fetch_add(numX, std::memory_order_relaxed);
-  m_NumY.fetch_add(numY, std::memory_order_relaxed);
-  m_NumZ.fetch_add(numZ, std::memory_order_relaxed);
-  m_NumXO.fetch_add(numXO, std::memory_order_relaxed);
-  m_NumYO.fetch_add(numYO, std::memory_order_relaxed);
-  m_NumZO.fetch_add(numZO, std::memory_order_relaxed);
+  if (computeProfile && !bandCounters.empty())
+  {
+    bandCounters[currentBand] += counters;
+  }
+  totalCounters += counters;
+
+  m_NumVoxelsInsideMask.fetch_add(totalCounters.numVoxelsInsideMask, std::memory_order_relaxed);
+  m_NumBoneVoxels.fetch_add(totalCounters.numBoneVoxels, std::memory_order_relaxed);
+  m_NumX.fetch_add(totalCounters.numX, std::memory_order_relaxed);
+  m_NumY.fetch_add(totalCounters.numY, std::memory_order_relaxed);
+  m_NumZ.fetch_add(totalCounters.numZ, std::memory_order_relaxed);
+  m_NumXO.fetch_add(totalCounters.numXO, std::memory_order_relaxed);
+  m_NumYO.fetch_add(totalCounters.numYO, std::memory_order_relaxed);
+  m_NumZO.fetch_add(totalCounters.numZO, std::memory_order_relaxed);
+
+  if (computeProfile)
+  {
+    const std::lock_guard<std::mutex> lock(m_ProfileMutex);
+    for (size_t band = 0; band < bandCounters.size(); ++band)
+    {
+      m_ProfileCounters[band] += bandCounters[band];
+    }
+  }
 }
 
 template <typename TInputImage, typename TMaskImage>
@@ -190,6 +400,13 @@ BoneMorphometryFeaturesFilter<TInputImage, TMaskImage>::PrintSelf(std::ostream &
 {
   Superclass::PrintSelf(os, indent);
   os << indent << "m_Threshold: " << m_Threshold << std::endl;
+  os << indent << "m_ThresholdMethod: " << m_ThresholdMethod << std::endl;
+  os << indent << "m_NumberOfHistogramBins: " << m_NumberOfHistogramBins << std::endl;
+  os << indent << "m_ThresholdPercentile: " << m_ThresholdPercentile << std::endl;
+  os << indent << "m_ComputedThreshold: " << m_ComputedThreshold << std::endl;
+  os << indent << "m_ComputeProfile: " << m_ComputeProfile << std::endl;
+  os << indent << "m_ProfileAxis: " << m_ProfileAxis << std::endl;
+  os << indent << "m_ProfileBandWidth: " << m_ProfileBandWidth << std::endl;
   os << indent << "m_Pp: " << m_Pp << std::endl;
   os << indent << "m_Pl: " << m_Pl << std::endl;
   os << indent << "m_PlX: " << m_PlX << std::endl;
@@ -203,6 +420,7 @@ BoneMorphometryFeaturesFilter<TInputImage, TMaskImage>::PrintSelf(std::ostream &
   os << indent << "m_NumXO: " << m_NumXO.load() << std::endl;
   os << indent << "m_NumYO: " << m_NumYO.load() << std::endl;
   os << indent << "m_NumZO: " << m_NumZO.load() << std::endl;
+  os << indent << "NumberOfProfileBands: " << m_PpProfile.size() << std::endl;
 }
 } // end namespace itk
 
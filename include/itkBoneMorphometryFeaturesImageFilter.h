@@ -25,7 +25,13 @@
 #include "itkConstNeighborhoodIterator.h"
 #include "itkSimpleDataObjectDecorator.h"
 #include "itkConstantBoundaryCondition.h"
+#include "itkFixedArray.h"
 
+#include <algorithm>
+#include <array>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace itk
@@ -55,6 +61,22 @@ namespace itk
  *    the image a crop step should be considered prior to the usage of this filter.
  * -# Mask: Even if optional, the usage of a mask will greatly improve the computation time.
  * -# Output: The filter output image will be either a vector image or an image containing vectors of 5 scalars
+ * -# Tiles: The output is processed in 3D tiles of TileSize voxels so that the neighborhood window stays in cache.
+ *    NumberOfWorkUnits workers each take the next unprocessed tile until none is left, so that the tiles outside
+ *    of the mask, which cost nothing, are balanced with the others. The default 32x32x32 tiles suit the default
+ *    radius; larger radii may benefit from smaller tiles. The filter requires dynamic multi-threading.
+ *
+ * Regional statistics: When ReduceOnly is on, the feature maps are not stored. The features of each voxel are
+ * computed on the fly and accumulated per label of the LabelImage, over the voxels inside the mask. The output
+ * image then has an empty buffered region, and the count, mean, standard deviation, minimum, maximum and quantiles
+ * of each feature are available per label through GetCount(), GetMean(), GetSigma(), GetMinimum(), GetMaximum(),
+ * GetMedian() and GetQuantile(). The features are indexed in the order of the output components. NaN and Inf
+ * features are left out of the statistics; when a feature has no finite value for a label, its mean, standard
+ * deviation, minimum, maximum and quantiles are NaN. The standard deviation of a single value is 0. The statistics
+ * cover the whole image and are reset by every update; the output requests an empty region, so that updating the
+ * filter again does not recompute them unless the filter or its inputs are modified. The quantiles are estimated
+ * from logarithmic buckets, within a relative error of QuantileRelativeAccuracy, so that the memory used does not
+ * depend on the number of voxels.
  *
  * \author: Jean-Baptiste Vimort
  * \ingroup BoneMorphometry
@@ -62,7 +84,8 @@ namespace itk
  */
 template <typename TInputImage,
           typename TOutputImage,
-          typename TMaskImage = Image<unsigned char, TInputImage::ImageDimension>>
+          typename TMaskImage = Image<unsigned char, TInputImage::ImageDimension>,
+          typename TLabelImage = TMaskImage>
 class ITK_TEMPLATE_EXPORT BoneMorphometryFeaturesImageFilter : public ImageToImageFilter<TInputImage, TOutputImage>
 {
 public:
@@ -90,12 +113,18 @@ public:
   /** Mask related type alias. */
   using MaskImagePointer = typename TMaskImage::Pointer;
 
+  /** Label related type alias. */
+  using LabelPixelType = typename TLabelImage::PixelType;
+
   /** Output related type alias. */
   using OutputImagePointer = typename TOutputImage::Pointer;
   using OutputRegionType = typename TOutputImage::RegionType;
   using OutputPixelType = typename TOutputImage::PixelType;
   using OutputRealType = typename NumericTraits<OutputPixelType>::ScalarRealType;
 
+  /** Number of features computed for each voxel. */
+  static constexpr unsigned int NumberOfFeatures = 5;
+
   /** NeighborhoodIterator type alias. */
   using BoundaryConditionType = ConstantBoundaryCondition<TInputImage>;
   using NeighborhoodIteratorType = ConstNeighborhoodIterator<TInputImage, BoundaryConditionType>;
@@ -118,6 +147,41 @@ public:
   itkSetMacro(NeighborhoodRadius, NeighborhoodRadiusType);
   itkGetConstMacro(NeighborhoodRadius, NeighborhoodRadiusType);
 
+  /** Method to set/get the size of the tiles in which the output is processed, non zero along each axis */
+  itkSetMacro(TileSize, SizeType);
+  itkGetConstMacro(TileSize, SizeType);
+
+  /** Methods to set/get the label image defining the regions of the statistics */
+  itkSetInputMacro(LabelImage, TLabelImage);
+  itkGetInputMacro(LabelImage, TLabelImage);
+
+  /** Methods to set/get whether only the statistics of the features per label are computed */
+  itkSetMacro(ReduceOnly, bool);
+  itkGetConstMacro(ReduceOnly, bool);
+  itkBooleanMacro(ReduceOnly);
+
+  /** Methods to set/get the relative accuracy of the quantiles of the statistics */
+  itkSetClampMacro(QuantileRelativeAccuracy, double, 1e-6, 0.5);
+  itkGetConstMacro(QuantileRelativeAccuracy, double);
+
+  /** Methods to get the statistics of the features per label, computed when ReduceOnly is on */
+  std::vector<LabelPixelType>
+  GetLabels() const;
+  SizeValueType
+  GetCount(LabelPixelType label, unsigned int feature) const;
+  RealType
+  GetMean(LabelPixelType label, unsigned int feature) const;
+  RealType
+  GetSigma(LabelPixelType label, unsigned int feature) const;
+  RealType
+  GetMinimum(LabelPixelType label, unsigned int feature) const;
+  RealType
+  GetMaximum(LabelPixelType label, unsigned int feature) const;
+  RealType
+  GetMedian(LabelPixelType label, unsigned int feature) const;
+  RealType
+  GetQuantile(LabelPixelType label, unsigned int feature, double p) const;
+
   /** Methods to get the mask different outputs */
 
 
@@ -135,10 +199,31 @@ protected:
   void
   GenerateOutputInformation() override;
 
+  /** In ReduceOnly mode, request an empty output region, matching the empty buffered region. */
+  void
+  EnlargeOutputRequestedRegion(DataObject * output) override;
+
+  /** In ReduceOnly mode, request the largest possible region of the input, mask and label images. */
+  void
+  GenerateInputRequestedRegion() override;
+
+  /** Check that dynamic multi-threading is on, that the tile size is not zero along any axis, and that a label
+   * image is given when ReduceOnly is on. */
+  void
+  VerifyPreconditions() const override;
+
+  /** Split the output in tiles of TileSize and hand them out to the threads on demand. */
+  void
+  GenerateData() override;
+
   /** Multi-thread version GenerateData. */
   void
   DynamicThreadedGenerateData(const RegionType & outputRegionForThread) override;
 
+  /** Accumulate the statistics of the features per label, without writing the output. */
+  void
+  ReduceThreadedGenerateData(const RegionType & regionForThread);
+
   bool
   IsInsideNeighborhood(const NeighborhoodOffsetType & iteratedOffset);
   bool
@@ -148,9 +233,68 @@ protected:
   PrintSelf(std::ostream & os, Indent indent) const override;
 
 private:
+  using FeaturesType = FixedArray<typename NumericTraits<OutputPixelType>::ValueType, NumberOfFeatures>;
+
+  /** Moments and quantile sketch of one feature over one label. The positive values are counted in buckets
+   * of logarithmic width, so that two accumulators can be merged by adding their buckets. */
+  struct FeatureAccumulator
+  {
+    SizeValueType                count{ 0 };
+    RealType                     sum{ 0 };
+    RealType                     sumOfSquares{ 0 };
+    RealType                     minimum{ NumericTraits<RealType>::max() };
+    RealType                     maximum{ NumericTraits<RealType>::NonpositiveMin() };
+    SizeValueType                zeroCount{ 0 };
+    std::map<int, SizeValueType> buckets;
+
+    FeatureAccumulator &
+    operator+=(const FeatureAccumulator & other)
+    {
+      count += other.count;
+      sum += other.sum;
+      sumOfSquares += other.sumOfSquares;
+      minimum = std::min(minimum, other.minimum);
+      maximum = std::max(maximum, other.maximum);
+      zeroCount += other.zeroCount;
+      for (const auto & bucket : other.buckets)
+      {
+        buckets[bucket.first] += bucket.second;
+      }
+      return *this;
+    }
+  };
+
+  using LabelAccumulatorType = std::array<FeatureAccumulator, NumberOfFeatures>;
+  using LabelAccumulatorMapType = std::unordered_map<LabelPixelType, LabelAccumulatorType>;
+
+  /** Compute the features of the neighborhood centered on the iterator position. */
+  void
+  ComputeFeatures(const NeighborhoodIteratorType &          inputNIt,
+                  const TMaskImage *                        maskPointer,
+                  const typename TInputImage::SpacingType & inSpacing,
+                  FeaturesType &                            features);
+
+  /** Check whether all the mask voxels of the region are zero. */
+  bool
+  IsOutsideMask(const RegionType & region, const TMaskImage * maskPointer) const;
+
+  void
+  AddFeatureValue(FeatureAccumulator & accumulator, RealType value) const;
+
+  const FeatureAccumulator &
+  GetFeatureAccumulator(LabelPixelType label, unsigned int feature) const;
+
   // Inputs
   RealType               m_Threshold;
   NeighborhoodRadiusType m_NeighborhoodRadius;
+  SizeType               m_TileSize;
+  bool                   m_ReduceOnly;
+  double                 m_QuantileRelativeAccuracy;
+
+  // Statistics of the features per label
+  double                  m_LogGamma;
+  LabelAccumulatorMapType m_LabelAccumulators;
+  std::mutex              m_LabelAccumulatorsMutex;
 
 }; // end of class
 } // end namespace itk
@@ -22,13 +22,21 @@
 #include "itkImageScanlineIterator.h"
 #include "itkProgressReporter.h"
 #include "itkNeighborhoodAlgorithm.h"
+#include "itkImageRegionIterator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 
 namespace itk
 {
-template <typename TInputImage, typename TOutputImage, typename TMaskImage>
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
 
-BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage>::BoneMorphometryFeaturesImageFilter()
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::BoneMorphometryFeaturesImageFilter()
   : m_Threshold(1)
+  , m_ReduceOnly(false)
+  , m_QuantileRelativeAccuracy(0.01)
+  , m_LogGamma(0)
 {
   this->SetNumberOfRequiredInputs(1);
 
@@ -36,11 +44,13 @@ BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage>::BoneM
   NeighborhoodType nhood;
   nhood.SetRadius(2);
   this->m_NeighborhoodRadius = nhood.GetRadius();
+
+  this->m_TileSize.Fill(32);
 }
 
-template <typename TInputImage, typename TOutputImage, typename TMaskImage>
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
 void
-BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage>::GenerateOutputInformation()
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::GenerateOutputInformation()
 {
   // Call superclass's version
   Superclass::GenerateOutputInformation();
@@ -56,18 +66,159 @@ BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage>::Gener
   }
 }
 
-template <typename TInputImage, typename TOutputImage, typename TMaskImage>
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+void
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::EnlargeOutputRequestedRegion(
+  DataObject * output)
+{
+  Superclass::EnlargeOutputRequestedRegion(output);
+
+  if (m_ReduceOnly)
+  {
+    // No feature map is stored: requesting an empty region, matching the empty buffered region, lets the
+    // pipeline consider the output up to date until the filter or its inputs are modified
+    auto *           outputImage = dynamic_cast<TOutputImage *>(output);
+    OutputRegionType emptyRegion = outputImage->GetLargestPossibleRegion();
+    emptyRegion.SetSize(typename OutputRegionType::SizeType{});
+    outputImage->SetRequestedRegion(emptyRegion);
+  }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+void
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+
+  if (m_ReduceOnly)
+  {
+    // The statistics are computed over the whole image, whatever the output requested region
+    auto * input = const_cast<TInputImage *>(this->GetInput());
+    if (input)
+    {
+      input->SetRequestedRegionToLargestPossibleRegion();
+    }
+    auto * mask = const_cast<TMaskImage *>(this->GetMaskImage());
+    if (mask)
+    {
+      mask->SetRequestedRegionToLargestPossibleRegion();
+    }
+    auto * labelImage = const_cast<TLabelImage *>(this->GetLabelImage());
+    if (labelImage)
+    {
+      labelImage->SetRequestedRegionToLargestPossibleRegion();
+    }
+  }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+void
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::VerifyPreconditions() const
+{
+  Superclass::VerifyPreconditions();
+
+  if (!this->GetDynamicMultiThreading())
+  {
+    itkExceptionMacro(<< "The features are computed by tiles, which requires dynamic multi-threading.");
+  }
+
+  for (unsigned int i = 0; i < TInputImage::ImageDimension; ++i)
+  {
+    if (m_TileSize[i] == 0)
+    {
+      itkExceptionMacro(<< "TileSize must be greater than zero along each axis, got " << m_TileSize);
+    }
+  }
+
+  if (m_ReduceOnly)
+  {
+    if (this->GetLabelImage() == nullptr)
+    {
+      itkExceptionMacro(<< "A label image is required to compute the statistics of the features.");
+    }
+  }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+void
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::GenerateData()
+{
+  // Statistics from a previous update must not outlive it
+  m_LabelAccumulators.clear();
+
+  // The statistics cover the whole image, the feature maps only the requested region
+  TOutputImage *   output = this->GetOutput();
+  OutputRegionType requestedRegion;
+  if (m_ReduceOnly)
+  {
+    // The feature maps are not stored, the output buffers its empty requested region
+    output->SetBufferedRegion(output->GetRequestedRegion());
+    output->Allocate();
+    requestedRegion = output->GetLargestPossibleRegion();
+
+    m_LogGamma = std::log((1.0 + m_QuantileRelativeAccuracy) / (1.0 - m_QuantileRelativeAccuracy));
+  }
+  else
+  {
+    this->AllocateOutputs();
+    requestedRegion = output->GetRequestedRegion();
+  }
+
+  // Number of tiles along each axis, the last tile of each axis may be smaller
+  const SizeType tileSize = m_TileSize;
+  SizeType       numberOfTilesPerAxis;
+  SizeValueType  numberOfTiles = 1;
+  for (unsigned int i = 0; i < TInputImage::ImageDimension; ++i)
+  {
+    numberOfTilesPerAxis[i] = (requestedRegion.GetSize(i) + tileSize[i] - 1) / tileSize[i];
+    numberOfTiles *= numberOfTilesPerAxis[i];
+  }
+
+  this->BeforeThreadedGenerateData();
+
+  // Each work unit takes the next unprocessed tile until none is left, so that the tiles are handed out on demand
+  const SizeValueType numberOfWorkers =
+    std::min<SizeValueType>(this->GetNumberOfWorkUnits(), std::max<SizeValueType>(numberOfTiles, 1));
+  std::atomic<SizeValueType> nextTile{ 0 };
+
+  MultiThreaderBase * multiThreader = this->GetMultiThreader();
+  multiThreader->SetNumberOfWorkUnits(static_cast<ThreadIdType>(numberOfWorkers));
+  multiThreader->ParallelizeArray(
+    0,
+    numberOfWorkers,
+    [this, &nextTile, numberOfTiles, &requestedRegion, &tileSize, &numberOfTilesPerAxis](SizeValueType) {
+      for (SizeValueType tile = nextTile++; tile < numberOfTiles; tile = nextTile++)
+      {
+        RegionType    tileRegion;
+        SizeValueType remainingTile = tile;
+        for (unsigned int i = 0; i < TInputImage::ImageDimension; ++i)
+        {
+          const SizeValueType tileIndex = remainingTile % numberOfTilesPerAxis[i];
+          remainingTile /= numberOfTilesPerAxis[i];
+
+          tileRegion.SetIndex(i, requestedRegion.GetIndex(i) + static_cast<IndexValueType>(tileIndex * tileSize[i]));
+          tileRegion.SetSize(i, std::min(tileSize[i], requestedRegion.GetSize(i) - tileIndex * tileSize[i]));
+        }
+        if (m_ReduceOnly)
+        {
+          this->ReduceThreadedGenerateData(tileRegion);
+        }
+        else
+        {
+          this->DynamicThreadedGenerateData(tileRegion);
+        }
+      }
+    },
+    this);
+
+  this->AfterThreadedGenerateData();
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
 void
-BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage>::DynamicThreadedGenerateData(
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::DynamicThreadedGenerateData(
   const RegionType & outputRegionForThread)
 {
-  NeighborhoodOffsetType            offsetX = { { 0, 0, 1 } };
-  NeighborhoodOffsetType            offsetXO = { { 0, 0, -1 } };
-  NeighborhoodOffsetType            offsetY = { { 0, 1, 0 } };
-  NeighborhoodOffsetType            offsetYO = { { 0, -1, 0 } };
-  NeighborhoodOffsetType            offsetZ = { { 1, 0, 0 } };
-  NeighborhoodOffsetType            offsetZO = { { -1, 0, 0 } };
-  NeighborhoodOffsetType            tempOffset;
   typename TInputImage::SpacingType inSpacing = this->GetInput()->GetSpacing();
 
   MaskImagePointer maskPointer = TMaskImage::New();
@@ -79,6 +230,19 @@ BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage>::Dynam
   firstIndex[2] = 0;
   TOutputImage *                   outputPtr = this->GetOutput();
   typename TOutputImage::PixelType outputPixel = outputPtr->GetPixel(firstIndex);
+  FeaturesType                     features;
+
+  // Skip the regions entirely outside of the mask without walking the neighborhoods
+  if (maskPointer && this->IsOutsideMask(outputRegionForThread, maskPointer))
+  {
+    outputPixel.Fill(0);
+    ImageRegionIterator<TOutputImage> outputIt(outputPtr, outputRegionForThread);
+    for (; !outputIt.IsAtEnd(); ++outputIt)
+    {
+      outputIt.Set(outputPixel);
+    }
+    return;
+  }
 
   NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<TInputImage>                        boundaryFacesCalculator;
   typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<TInputImage>::FaceListType faceList =
@@ -106,86 +270,359 @@ BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage>::Dynam
         continue;
       }
 
-      SizeValueType numVoxels = 0;
-      SizeValueType numBoneVoxels = 0;
-      SizeValueType numX = 0;
-      SizeValueType numY = 0;
-      SizeValueType numZ = 0;
-      SizeValueType numXO = 0;
-      SizeValueType numYO = 0;
-      SizeValueType numZO = 0;
-
-      // Iteration over the all neighborhood region
-      for (NeighborIndexType nb = 0; nb < inputNIt.Size(); ++nb)
+      this->ComputeFeatures(inputNIt, maskPointer, inSpacing, features);
+      for (unsigned int feature = 0; feature < NumberOfFeatures; ++feature)
       {
-        IndexType ind = inputNIt.GetIndex(nb);
+        outputPixel[feature] = features[feature];
+      }
 
-        if (maskPointer && !(this->IsInsideMaskRegion(ind, maskPointer->GetBufferedRegion().GetSize())))
-        {
-          continue;
-        }
+      outputIt.Set(outputPixel);
 
-        if (maskPointer && maskPointer->GetPixel(ind) == 0)
-        {
-          continue;
-        }
+      ++inputNIt;
+      ++outputIt;
+    }
+  }
+}
 
-        ++numVoxels;
-        inputNIt.GetPixel(nb);
-        tempOffset = inputNIt.GetOffset(nb);
-        if (inputNIt.GetPixel(tempOffset) >= m_Threshold)
-        {
-          ++numBoneVoxels;
-          if (this->IsInsideNeighborhood(tempOffset + offsetX) && inputNIt.GetPixel(tempOffset + offsetX) < m_Threshold)
-          {
-            ++numXO;
-          }
-          if (this->IsInsideNeighborhood(tempOffset + offsetXO) &&
-              inputNIt.GetPixel(tempOffset + offsetXO) < m_Threshold)
-          {
-            ++numX;
-          }
-          if (this->IsInsideNeighborhood(tempOffset + offsetY) && inputNIt.GetPixel(tempOffset + offsetY) < m_Threshold)
-          {
-            ++numYO;
-          }
-          if (this->IsInsideNeighborhood(tempOffset + offsetYO) &&
-              inputNIt.GetPixel(tempOffset + offsetYO) < m_Threshold)
-          {
-            ++numY;
-          }
-          if (this->IsInsideNeighborhood(tempOffset + offsetZ) && inputNIt.GetPixel(tempOffset + offsetZ) < m_Threshold)
-          {
-            ++numZO;
-          }
-          if (this->IsInsideNeighborhood(tempOffset + offsetZO) &&
-              inputNIt.GetPixel(tempOffset + offsetZO) < m_Threshold)
-          {
-            ++numZ;
-          }
-        }
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+void
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::ReduceThreadedGenerateData(
+  const RegionType & regionForThread)
+{
+  typename TInputImage::SpacingType inSpacing = this->GetInput()->GetSpacing();
+  const TMaskImage *                maskPointer = this->GetMaskImage();
+  const TLabelImage *               labelPointer = this->GetLabelImage();
+  FeaturesType                      features;
+  LabelAccumulatorMapType           labelAccumulators;
+
+  if (maskPointer && this->IsOutsideMask(regionForThread, maskPointer))
+  {
+    return;
+  }
+
+  NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<TInputImage>                        boundaryFacesCalculator;
+  typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<TInputImage>::FaceListType faceList =
+    boundaryFacesCalculator(this->GetInput(), regionForThread, m_NeighborhoodRadius);
+  auto fit = faceList.begin();
+
+  for (; fit != faceList.end(); ++fit)
+  {
+    NeighborhoodIteratorType inputNIt(m_NeighborhoodRadius, this->GetInput(), *fit);
+    BoundaryConditionType    BoundaryCondition;
+    inputNIt.SetBoundaryCondition(BoundaryCondition);
+    inputNIt.GoToBegin();
+
+    while (!inputNIt.IsAtEnd())
+    {
+      const IndexType index = inputNIt.GetIndex();
+      if (maskPointer && maskPointer->GetPixel(index) == 0)
+      {
+        ++inputNIt;
+        continue;
       }
 
-      RealType PlX = (RealType)((numX + numXO) / 2.0) / (RealType)(numVoxels * inSpacing[0]) * 2;
-      RealType PlY = (RealType)((numY + numYO) / 2.0) / (RealType)(numVoxels * inSpacing[1]) * 2;
-      RealType PlZ = (RealType)((numZ + numZO) / 2.0) / (RealType)(numVoxels * inSpacing[2]) * 2;
-      outputPixel[0] = (RealType)numBoneVoxels / (RealType)numVoxels;
-      outputPixel[1] = (PlX + PlY + PlZ) / 3.0;
-      outputPixel[2] = outputPixel[0] / outputPixel[1];
-      outputPixel[3] = (1.0 - outputPixel[0]) / outputPixel[1];
-      outputPixel[4] = 2.0 * (outputPixel[1] / outputPixel[0]);
+      this->ComputeFeatures(inputNIt, maskPointer, inSpacing, features);
 
-      outputIt.Set(outputPixel);
+      LabelAccumulatorType & labelAccumulator = labelAccumulators[labelPointer->GetPixel(index)];
+      for (unsigned int feature = 0; feature < NumberOfFeatures; ++feature)
+      {
+        this->AddFeatureValue(labelAccumulator[feature], features[feature]);
+      }
 
       ++inputNIt;
-      ++outputIt;
     }
   }
+
+  const std::lock_guard<std::mutex> lock(m_LabelAccumulatorsMutex);
+  for (const auto & labelAccumulator : labelAccumulators)
+  {
+    LabelAccumulatorType & totalAccumulator = m_LabelAccumulators[labelAccumulator.first];
+    for (unsigned int feature = 0; feature < NumberOfFeatures; ++feature)
+    {
+      totalAccumulator[feature] += labelAccumulator.second[feature];
+    }
+  }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+void
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::ComputeFeatures(
+  const NeighborhoodIteratorType &          inputNIt,
+  const TMaskImage *                        maskPointer,
+  const typename TInputImage::SpacingType & inSpacing,
+  FeaturesType &                            features)
+{
+  NeighborhoodOffsetType offsetX = { { 0, 0, 1 } };
+  NeighborhoodOffsetType offsetXO = { { 0, 0, -1 } };
+  NeighborhoodOffsetType offsetY = { { 0, 1, 0 } };
+  NeighborhoodOffsetType offsetYO = { { 0, -1, 0 } };
+  NeighborhoodOffsetType offsetZ = { { 1, 0, 0 } };
+  NeighborhoodOffsetType offsetZO = { { -1, 0, 0 } };
+  NeighborhoodOffsetType tempOffset;
+
+  SizeValueType numVoxels = 0;
+  SizeValueType numBoneVoxels = 0;
+  SizeValueType numX = 0;
+  SizeValueType numY = 0;
+  SizeValueType numZ = 0;
+  SizeValueType numXO = 0;
+  SizeValueType numYO = 0;
+  SizeValueType numZO = 0;
+
+  // Iteration over the all neighborhood region
+  for (NeighborIndexType nb = 0; nb < inputNIt.Size(); ++nb)
+  {
+    IndexType ind = inputNIt.GetIndex(nb);
+
+    if (maskPointer && !(this->IsInsideMaskRegion(ind, maskPointer->GetBufferedRegion().GetSize())))
+    {
+      continue;
+    }
+
+    if (maskPointer && maskPointer->GetPixel(ind) == 0)
+    {
+      continue;
+    }
+
+    ++numVoxels;
+    tempOffset = inputNIt.GetOffset(nb);
+    if (inputNIt.GetPixel(tempOffset) >= m_Threshold)
+    {
+      ++numBoneVoxels;
+      if (this->IsInsideNeighborhood(tempOffset + offsetX) && inputNIt.GetPixel(tempOffset + offsetX) < m_Threshold)
+      {
+        ++numXO;
+      }
+      if (this->IsInsideNeighborhood(tempOffset + offsetXO) && inputNIt.GetPixel(tempOffset + offsetXO) < m_Threshold)
+      {
+        ++numX;
+      }
+      if (this->IsInsideNeighborhood(tempOffset + offsetY) && inputNIt.GetPixel(tempOffset + offsetY) < m_Threshold)
+      {
+        ++numYO;
+      }
+      if (this->IsInsideNeighborhood(tempOffset + offsetYO) && inputNIt.GetPixel(tempOffset + offsetYO) < m_Threshold)
+      {
+        ++numY;
+      }
+      if (this->IsInsideNeighborhood(tempOffset + offsetZ) && inputNIt.GetPixel(tempOffset + offsetZ) < m_Threshold)
+      {
+        ++numZO;
+      }
+      if (this->IsInsideNeighborhood(tempOffset + offsetZO) && inputNIt.GetPixel(tempOffset + offsetZO) < m_Threshold)
+      {
+        ++numZ;
+      }
+    }
+  }
+
+  RealType PlX = (RealType)((numX + numXO) / 2.0) / (RealType)(numVoxels * inSpacing[0]) * 2;
+  RealType PlY = (RealType)((numY + numYO) / 2.0) / (RealType)(numVoxels * inSpacing[1]) * 2;
+  RealType PlZ = (RealType)((numZ + numZO) / 2.0) / (RealType)(numVoxels * inSpacing[2]) * 2;
+  features[0] = (RealType)numBoneVoxels / (RealType)numVoxels;
+  features[1] = (PlX + PlY + PlZ) / 3.0;
+  features[2] = features[0] / features[1];
+  features[3] = (1.0 - features[0]) / features[1];
+  features[4] = 2.0 * (features[1] / features[0]);
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+bool
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::IsOutsideMask(
+  const RegionType & region,
+  const TMaskImage * maskPointer) const
+{
+  ImageRegionConstIterator<TMaskImage> maskIt(maskPointer, region);
+  for (; !maskIt.IsAtEnd(); ++maskIt)
+  {
+    if (maskIt.Get() != 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+void
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::AddFeatureValue(
+  FeatureAccumulator & accumulator,
+  RealType             value) const
+{
+  // NaN and Inf values, from neighborhoods without bone voxel, are left out of the statistics
+  if (!std::isfinite(value))
+  {
+    return;
+  }
+
+  ++accumulator.count;
+  accumulator.sum += value;
+  accumulator.sumOfSquares += value * value;
+  accumulator.minimum = std::min(accumulator.minimum, value);
+  accumulator.maximum = std::max(accumulator.maximum, value);
+  if (value > 0)
+  {
+    ++accumulator.buckets[static_cast<int>(std::ceil(std::log(value) / m_LogGamma))];
+  }
+  else
+  {
+    ++accumulator.zeroCount;
+  }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+auto
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::GetFeatureAccumulator(
+  LabelPixelType label,
+  unsigned int   feature) const -> const FeatureAccumulator &
+{
+  const auto it = m_LabelAccumulators.find(label);
+  if (it == m_LabelAccumulators.end())
+  {
+    itkExceptionMacro(<< "No statistics for label "
+                      << static_cast<typename NumericTraits<LabelPixelType>::PrintType>(label));
+  }
+  if (feature >= NumberOfFeatures)
+  {
+    itkExceptionMacro(<< "Feature " << feature << " is out of range, there are " << NumberOfFeatures << " features");
+  }
+  return it->second[feature];
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+auto
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::GetLabels() const
+  -> std::vector<LabelPixelType>
+{
+  std::vector<LabelPixelType> labels;
+  labels.reserve(m_LabelAccumulators.size());
+  for (const auto & labelAccumulator : m_LabelAccumulators)
+  {
+    labels.push_back(labelAccumulator.first);
+  }
+  std::sort(labels.begin(), labels.end());
+  return labels;
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+SizeValueType
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::GetCount(
+  LabelPixelType label,
+  unsigned int   feature) const
+{
+  return this->GetFeatureAccumulator(label, feature).count;
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+auto
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::GetMean(
+  LabelPixelType label,
+  unsigned int   feature) const -> RealType
+{
+  const FeatureAccumulator & accumulator = this->GetFeatureAccumulator(label, feature);
+  if (accumulator.count == 0)
+  {
+    return NumericTraits<RealType>::quiet_NaN();
+  }
+  return accumulator.sum / static_cast<RealType>(accumulator.count);
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+auto
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::GetSigma(
+  LabelPixelType label,
+  unsigned int   feature) const -> RealType
+{
+  const FeatureAccumulator & accumulator = this->GetFeatureAccumulator(label, feature);
+  if (accumulator.count == 0)
+  {
+    return NumericTraits<RealType>::quiet_NaN();
+  }
+  if (accumulator.count == 1)
+  {
+    return 0;
+  }
+
+  const RealType count = static_cast<RealType>(accumulator.count);
+  const RealType variance =
+    (accumulator.sumOfSquares - accumulator.sum * accumulator.sum / count) / (count - 1);
+  return std::sqrt(std::max(variance, RealType{ 0 }));
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+auto
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::GetMinimum(
+  LabelPixelType label,
+  unsigned int   feature) const -> RealType
+{
+  const FeatureAccumulator & accumulator = this->GetFeatureAccumulator(label, feature);
+  if (accumulator.count == 0)
+  {
+    return NumericTraits<RealType>::quiet_NaN();
+  }
+  return accumulator.minimum;
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+auto
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::GetMaximum(
+  LabelPixelType label,
+  unsigned int   feature) const -> RealType
+{
+  const FeatureAccumulator & accumulator = this->GetFeatureAccumulator(label, feature);
+  if (accumulator.count == 0)
+  {
+    return NumericTraits<RealType>::quiet_NaN();
+  }
+  return accumulator.maximum;
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+auto
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::GetQuantile(
+  LabelPixelType label,
+  unsigned int   feature,
+  double         p) const -> RealType
+{
+  const FeatureAccumulator & accumulator = this->GetFeatureAccumulator(label, feature);
+  if (accumulator.count == 0)
+  {
+    return NumericTraits<RealType>::quiet_NaN();
+  }
+
+  const double  rank = std::min(std::max(p, 0.0), 1.0) * (accumulator.count - 1);
+  SizeValueType cumulativeCount = accumulator.zeroCount;
+  if (rank < cumulativeCount)
+  {
+    return 0;
+  }
+
+  // Each bucket is represented by the value with the smallest relative error to the values it holds
+  const RealType gamma = std::exp(m_LogGamma);
+  for (const auto & bucket : accumulator.buckets)
+  {
+    cumulativeCount += bucket.second;
+    if (rank < cumulativeCount)
+    {
+      const RealType value = 2.0 * std::exp(bucket.first * m_LogGamma) / (gamma + 1.0);
+      return std::min(std::max(value, accumulator.minimum), accumulator.maximum);
+    }
+  }
+  return accumulator.maximum;
+}
+
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
+auto
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::GetMedian(
+  LabelPixelType label,
+  unsigned int   feature) const -> RealType
+{
+  return this->GetQuantile(label, feature, 0.5);
 }
 
-template <typename TInputImage, typename TOutputImage, typename TMaskImage>
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
 bool
-BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage>::IsInsideMaskRegion(
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::IsInsideMaskRegion(
   const IndexType &                     imageIndex,
   const typename TMaskImage::SizeType & maskSize)
 {
@@ -201,9 +638,9 @@ BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage>::IsIns
   return insideMask;
 }
 
-template <typename TInputImage, typename TOutputImage, typename TMaskImage>
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
 bool
-BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage>::IsInsideNeighborhood(
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::IsInsideNeighborhood(
   const NeighborhoodOffsetType & iteratedOffset)
 {
   bool insideNeighborhood = true;
@@ -220,13 +657,19 @@ BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage>::IsIns
 }
 
 
-template <typename TInputImage, typename TOutputImage, typename TMaskImage>
+template <typename TInputImage, typename TOutputImage, typename TMaskImage, typename TLabelImage>
 void
-BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage>::PrintSelf(std::ostream & os,
-                                                                                     Indent         indent) const
+BoneMorphometryFeaturesImageFilter<TInputImage, TOutputImage, TMaskImage, TLabelImage>::PrintSelf(
+  std::ostream & os,
+  Indent         indent) const
 {
   Superclass::PrintSelf(os, indent);
   os << indent << "m_Threshold: " << m_Threshold << std::endl;
+  os << indent << "m_NeighborhoodRadius: " << m_NeighborhoodRadius << std::endl;
+  os << indent << "m_TileSize: " << m_TileSize << std::endl;
+  os << indent << "m_ReduceOnly: " << m_ReduceOnly << std::endl;
+  os << indent << "m_QuantileRelativeAccuracy: " << m_QuantileRelativeAccuracy << std::endl;
+  os << indent << "NumberOfLabels: " << m_LabelAccumulators.size() << std::endl;
 }
 } // end namespace itk
 
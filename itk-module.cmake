@@ -17,6 +17,7 @@ itk_module(BoneMorphometry
     ITKStatistics
     ITKImageGrid
     ITKMathematicalMorphology
+    ITKThresholding
   COMPILE_DEPENDS
     ITKImageSources
   TEST_DEPENDS
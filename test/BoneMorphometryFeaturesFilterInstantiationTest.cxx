@@ -21,8 +21,15 @@
 #include "itkImage.h"
 #include "itkVector.h"
 #include "itkImageFileReader.h"
+#include "itkImageRegionIterator.h"
+#include "itkMinimumMaximumImageCalculator.h"
+#include "itkOtsuThresholdImageFilter.h"
+#include "itkRegionOfInterestImageFilter.h"
 #include "itkTestingMacros.h"
 
+#include <algorithm>
+#include <vector>
+
 int
 BoneMorphometryFeaturesFilterInstantiationTest(int argc, char * argv[])
 {
@@ -67,10 +74,190 @@ BoneMorphometryFeaturesFilterInstantiationTest(int argc, char * argv[])
   ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
 
   ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(0.232113, filter->GetBVTV(), 6, 0.000001));
+  ITK_TEST_EXPECT_EQUAL(1300, filter->GetComputedThreshold());
   ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(0.281487, filter->GetTbN(), 6, 0.000001));
   ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(0.824595, filter->GetTbTh(), 6, 0.000001));
   ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(2.72796, filter->GetTbSp(), 5, 0.00001));
   ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(2.42543, filter->GetBSBV(), 5, 0.00001));
+  ITK_TEST_EXPECT_EQUAL(0, filter->GetNumberOfProfileBands());
+
+  // A profile with a single band spanning the whole volume gives back the global metrics
+  const FilterType::SizeType size = reader->GetOutput()->GetLargestPossibleRegion().GetSize();
+
+  ITK_TEST_SET_GET_BOOLEAN(filter, ComputeProfile, true);
+
+  filter->SetProfileAxis(2);
+  ITK_TEST_SET_GET_VALUE(2, filter->GetProfileAxis());
+
+  filter->SetProfileBandWidth(size[2]);
+  ITK_TEST_SET_GET_VALUE(size[2], filter->GetProfileBandWidth());
+
+  ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
+
+  ITK_TEST_EXPECT_EQUAL(1, filter->GetNumberOfProfileBands());
+  ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(filter->GetBVTV(), filter->GetBVTVProfile()[0], 6, 0.000001));
+  ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(filter->GetTbN(), filter->GetTbNProfile()[0], 6, 0.000001));
+  ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(filter->GetTbTh(), filter->GetTbThProfile()[0], 6, 0.000001));
+  ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(filter->GetTbSp(), filter->GetTbSpProfile()[0], 5, 0.00001));
+  ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(filter->GetBSBV(), filter->GetBSBVProfile()[0], 5, 0.00001));
+
+  // One band per slice
+  filter->SetProfileBandWidth(1);
+  ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
+
+  ITK_TEST_EXPECT_EQUAL(size[2], filter->GetNumberOfProfileBands());
+  ITK_TEST_EXPECT_EQUAL(size[2], filter->GetBVTVProfile().size());
+
+  // Bands along another axis, the last one shorter than the others
+  constexpr unsigned int profileAxis = 0;
+  itk::SizeValueType     bandWidth = std::max<itk::SizeValueType>(size[profileAxis] / 3, 1);
+  while (size[profileAxis] % bandWidth == 0 && bandWidth < size[profileAxis])
+  {
+    ++bandWidth;
+  }
+  ITK_TEST_EXPECT_TRUE(size[profileAxis] % bandWidth != 0);
+
+  filter->SetProfileAxis(profileAxis);
+  filter->SetProfileBandWidth(bandWidth);
+  ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
+
+  const itk::SizeValueType numberOfBands = (size[profileAxis] + bandWidth - 1) / bandWidth;
+  ITK_TEST_EXPECT_EQUAL(numberOfBands, filter->GetNumberOfProfileBands());
+
+  const FilterType::RealArrayType bvtvProfile = filter->GetBVTVProfile();
+  const FilterType::RealArrayType tbNProfile = filter->GetTbNProfile();
+  const FilterType::RealArrayType tbThProfile = filter->GetTbThProfile();
+  const FilterType::RealArrayType tbSpProfile = filter->GetTbSpProfile();
+  const FilterType::RealArrayType bsbvProfile = filter->GetBSBVProfile();
+
+  // Each band matches the filter run on the band extracted from the scan. The extract keeps one more slice on
+  // each side, left out by the mask, so that the voxels on the faces of the band see the same neighbors as in the
+  // whole scan.
+  using MaskImageType = itk::Image<unsigned char, ImageDimension>;
+  using RegionOfInterestFilterType = itk::RegionOfInterestImageFilter<InputImageType, InputImageType>;
+
+  const InputImageType::RegionType largestRegion = reader->GetOutput()->GetLargestPossibleRegion();
+  const itk::IndexValueType        axisStart = largestRegion.GetIndex(profileAxis);
+  const itk::IndexValueType        axisEnd = axisStart + static_cast<itk::IndexValueType>(size[profileAxis]);
+  for (itk::SizeValueType band = 0; band < numberOfBands; ++band)
+  {
+    const itk::IndexValueType bandStart = axisStart + static_cast<itk::IndexValueType>(band * bandWidth);
+    const itk::IndexValueType bandEnd =
+      std::min(bandStart + static_cast<itk::IndexValueType>(bandWidth), axisEnd);
+    const itk::IndexValueType extractStart = std::max(bandStart - 1, axisStart);
+    const itk::IndexValueType extractEnd = std::min(bandEnd + 1, axisEnd);
+
+    InputImageType::RegionType extractRegion = largestRegion;
+    extractRegion.SetIndex(profileAxis, extractStart);
+    extractRegion.SetSize(profileAxis, static_cast<itk::SizeValueType>(extractEnd - extractStart));
+
+    auto regionOfInterestFilter = RegionOfInterestFilterType::New();
+    regionOfInterestFilter->SetInput(reader->GetOutput());
+    regionOfInterestFilter->SetRegionOfInterest(extractRegion);
+    ITK_TRY_EXPECT_NO_EXCEPTION(regionOfInterestFilter->Update());
+
+    auto bandMask = MaskImageType::New();
+    bandMask->CopyInformation(regionOfInterestFilter->GetOutput());
+    bandMask->SetRegions(regionOfInterestFilter->GetOutput()->GetLargestPossibleRegion());
+    bandMask->Allocate();
+    bandMask->FillBuffer(0);
+
+    MaskImageType::RegionType bandRegion = bandMask->GetLargestPossibleRegion();
+    bandRegion.SetIndex(profileAxis, bandRegion.GetIndex(profileAxis) + bandStart - extractStart);
+    bandRegion.SetSize(profileAxis, static_cast<itk::SizeValueType>(bandEnd - bandStart));
+    itk::ImageRegionIterator<MaskImageType> bandMaskIt(bandMask, bandRegion);
+    for (; !bandMaskIt.IsAtEnd(); ++bandMaskIt)
+    {
+      bandMaskIt.Set(1);
+    }
+
+    auto bandFilter = FilterType::New();
+    bandFilter->SetInput(regionOfInterestFilter->GetOutput());
+    bandFilter->SetMaskImage(bandMask);
+    bandFilter->SetThreshold(1300);
+    ITK_TRY_EXPECT_NO_EXCEPTION(bandFilter->Update());
+
+    ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(bandFilter->GetBVTV(), bvtvProfile[band], 4, 1e-12));
+    ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(bandFilter->GetTbN(), tbNProfile[band], 4, 1e-12));
+    ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(bandFilter->GetTbTh(), tbThProfile[band], 4, 1e-12));
+    ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(bandFilter->GetTbSp(), tbSpProfile[band], 4, 1e-12));
+    ITK_TEST_EXPECT_TRUE(itk::Math::FloatAlmostEqual(bandFilter->GetBSBV(), bsbvProfile[band], 4, 1e-12));
+  }
+
+  filter->ComputeProfileOff();
+
+  // The automatic thresholds are compared with references computed on the whole scan, within one bin
+  constexpr unsigned int numberOfHistogramBins = 512;
+
+  using MinimumMaximumCalculatorType = itk::MinimumMaximumImageCalculator<InputImageType>;
+  auto minimumMaximumCalculator = MinimumMaximumCalculatorType::New();
+  minimumMaximumCalculator->SetImage(reader->GetOutput());
+  minimumMaximumCalculator->Compute();
+  const double binWidth =
+    (static_cast<double>(minimumMaximumCalculator->GetMaximum()) - minimumMaximumCalculator->GetMinimum()) /
+    numberOfHistogramBins;
+
+  filter->SetNumberOfHistogramBins(1);
+  ITK_TEST_SET_GET_VALUE(2, filter->GetNumberOfHistogramBins());
+
+  // Otsu threshold chosen from the histogram of the scan
+  filter->SetThresholdMethod(FilterType::ThresholdMethodEnum::Otsu);
+  ITK_TEST_SET_GET_VALUE(FilterType::ThresholdMethodEnum::Otsu, filter->GetThresholdMethod());
+
+  filter->SetNumberOfHistogramBins(numberOfHistogramBins);
+  ITK_TEST_SET_GET_VALUE(numberOfHistogramBins, filter->GetNumberOfHistogramBins());
+
+  ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
+
+  using OtsuFilterType = itk::OtsuThresholdImageFilter<InputImageType, MaskImageType>;
+  auto otsuFilter = OtsuFilterType::New();
+  otsuFilter->SetInput(reader->GetOutput());
+  otsuFilter->SetNumberOfHistogramBins(numberOfHistogramBins);
+  ITK_TRY_EXPECT_NO_EXCEPTION(otsuFilter->Update());
+
+  ITK_TEST_EXPECT_TRUE(itk::Math::abs(filter->GetComputedThreshold() - otsuFilter->GetThreshold()) <= binWidth);
+  ITK_TEST_EXPECT_TRUE(filter->GetBVTV() > 0.0 && filter->GetBVTV() < 1.0);
+
+  // Percentile thresholds match the percentiles of the sorted intensities
+  std::vector<InputPixelType>                   intensities;
+  itk::ImageRegionConstIterator<InputImageType> intensityIt(reader->GetOutput(), largestRegion);
+  intensities.reserve(largestRegion.GetNumberOfPixels());
+  for (; !intensityIt.IsAtEnd(); ++intensityIt)
+  {
+    intensities.push_back(intensityIt.Get());
+  }
+  std::sort(intensities.begin(), intensities.end());
+
+  filter->SetThresholdMethod(FilterType::ThresholdMethodEnum::Percentile);
+
+  filter->SetThresholdPercentile(10.0);
+  ITK_TEST_SET_GET_VALUE(10.0, filter->GetThresholdPercentile());
+  ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
+  const FilterType::RealType lowThreshold = filter->GetComputedThreshold();
+  const InputPixelType       lowPercentile = intensities[static_cast<size_t>(0.1 * (intensities.size() - 1))];
+  ITK_TEST_EXPECT_TRUE(itk::Math::abs(lowThreshold - lowPercentile) <= binWidth);
+
+  filter->SetThresholdPercentile(90.0);
+  ITK_TRY_EXPECT_NO_EXCEPTION(filter->Update());
+  const FilterType::RealType highThreshold = filter->GetComputedThreshold();
+  const InputPixelType       highPercentile = intensities[static_cast<size_t>(0.9 * (intensities.size() - 1))];
+  ITK_TEST_EXPECT_TRUE(itk::Math::abs(highThreshold - highPercentile) <= binWidth);
+
+  ITK_TEST_EXPECT_TRUE(lowThreshold < highThreshold);
+
+  // A constant image has nothing to separate, the automatic methods fall back to Threshold
+  auto                           constantImage = InputImageType::New();
+  const InputImageType::SizeType constantSize = { { 8, 8, 8 } };
+  constantImage->SetRegions(constantSize);
+  constantImage->Allocate();
+  constantImage->FillBuffer(1000);
+
+  auto constantFilter = FilterType::New();
+  constantFilter->SetInput(constantImage);
+  constantFilter->SetThreshold(500);
+  constantFilter->SetThresholdMethod(FilterType::ThresholdMethodEnum::Otsu);
+  ITK_TRY_EXPECT_NO_EXCEPTION(constantFilter->Update());
+  ITK_TEST_EXPECT_EQUAL(500, constantFilter->GetComputedThreshold());
 
   std::cout << "Test finished." << std::endl;
   return EXIT_SUCCESS;
@@ -22,8 +22,15 @@
 #include "itkVector.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
 #include "itkTestingMacros.h"
 
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+
 int
 BoneMorphometryFeaturesImageFilterInstantiationTest(int argc, char * argv[])
 {
@@ -80,6 +87,215 @@ BoneMorphometryFeaturesImageFilterInstantiationTest(int argc, char * argv[])
 
   ITK_TRY_EXPECT_NO_EXCEPTION(writer->Update());
 
+  // Tiles not dividing the image evenly give the same feature maps as the default tiles
+  FilterType::Pointer tiledFilter = FilterType::New();
+  tiledFilter->SetInput(reader->GetOutput());
+  tiledFilter->SetMaskImage(maskReader->GetOutput());
+  tiledFilter->SetThreshold(1300);
+
+  FilterType::SizeType tileSize;
+  tileSize.Fill(0);
+  tiledFilter->SetTileSize(tileSize);
+  ITK_TRY_EXPECT_EXCEPTION(tiledFilter->Update());
+
+  tileSize[0] = 7;
+  tileSize[1] = 11;
+  tileSize[2] = 5;
+  tiledFilter->SetTileSize(tileSize);
+  ITK_TEST_SET_GET_VALUE(tileSize, tiledFilter->GetTileSize());
+
+  tiledFilter->DynamicMultiThreadingOff();
+  ITK_TRY_EXPECT_EXCEPTION(tiledFilter->Update());
+  tiledFilter->DynamicMultiThreadingOn();
+
+  ITK_TRY_EXPECT_NO_EXCEPTION(tiledFilter->Update());
+
+  itk::SizeValueType                             numberOfDifferences = 0;
+  itk::ImageRegionConstIterator<OutputImageType> mapIt(filter->GetOutput(), filter->GetOutput()->GetBufferedRegion());
+  itk::ImageRegionConstIterator<OutputImageType> tiledMapIt(tiledFilter->GetOutput(),
+                                                            filter->GetOutput()->GetBufferedRegion());
+  for (; !mapIt.IsAtEnd(); ++mapIt, ++tiledMapIt)
+  {
+    for (unsigned int feature = 0; feature < VectorComponentDimension; ++feature)
+    {
+      const OutputPixelComponentType value = mapIt.Get()[feature];
+      const OutputPixelComponentType tiledValue = tiledMapIt.Get()[feature];
+      if (!itk::Math::ExactlyEquals(value, tiledValue) && !(std::isnan(value) && std::isnan(tiledValue)))
+      {
+        ++numberOfDifferences;
+      }
+    }
+  }
+  ITK_TEST_EXPECT_EQUAL(0, numberOfDifferences);
+
+  // Label image splitting the mask in two labels, at the middle slice of the mask
+  using LabelImageType = itk::Image<unsigned char, ImageDimension>;
+  const InputImageType *           mask = maskReader->GetOutput();
+  const InputImageType::RegionType region = filter->GetOutput()->GetBufferedRegion();
+
+  itk::IndexValueType firstMaskSlice = itk::NumericTraits<itk::IndexValueType>::max();
+  itk::IndexValueType lastMaskSlice = itk::NumericTraits<itk::IndexValueType>::min();
+
+  itk::ImageRegionConstIteratorWithIndex<InputImageType> maskIt(mask, region);
+  for (; !maskIt.IsAtEnd(); ++maskIt)
+  {
+    if (maskIt.Get() != 0)
+    {
+      firstMaskSlice = std::min(firstMaskSlice, maskIt.GetIndex()[2]);
+      lastMaskSlice = std::max(lastMaskSlice, maskIt.GetIndex()[2]);
+    }
+  }
+  ITK_TEST_EXPECT_TRUE(firstMaskSlice < lastMaskSlice);
+  const itk::IndexValueType middleMaskSlice = (firstMaskSlice + lastMaskSlice) / 2;
+
+  auto labelImage = LabelImageType::New();
+  labelImage->CopyInformation(mask);
+  labelImage->SetRegions(region);
+  labelImage->Allocate();
+  itk::ImageRegionIterator<LabelImageType> labelIt(labelImage, region);
+  for (maskIt.GoToBegin(); !maskIt.IsAtEnd(); ++maskIt, ++labelIt)
+  {
+    if (maskIt.Get() == 0)
+    {
+      labelIt.Set(0);
+    }
+    else
+    {
+      labelIt.Set(maskIt.GetIndex()[2] <= middleMaskSlice ? 1 : 2);
+    }
+  }
+
+  // Statistics of the features per label, computed without storing the feature maps
+  using StatisticsFilterType =
+    itk::BoneMorphometryFeaturesImageFilter<InputImageType, OutputImageType, InputImageType, LabelImageType>;
+  auto statisticsFilter = StatisticsFilterType::New();
+  statisticsFilter->SetInput(reader->GetOutput());
+  statisticsFilter->SetMaskImage(maskReader->GetOutput());
+  statisticsFilter->SetThreshold(1300);
+
+  ITK_TEST_SET_GET_BOOLEAN(statisticsFilter, ReduceOnly, true);
+  ITK_TRY_EXPECT_EXCEPTION(statisticsFilter->Update());
+
+  statisticsFilter->SetLabelImage(labelImage);
+  ITK_TEST_SET_GET_VALUE(labelImage.GetPointer(), statisticsFilter->GetLabelImage());
+
+  constexpr double quantileRelativeAccuracy = 0.005;
+  statisticsFilter->SetQuantileRelativeAccuracy(quantileRelativeAccuracy);
+  ITK_TEST_SET_GET_VALUE(quantileRelativeAccuracy, statisticsFilter->GetQuantileRelativeAccuracy());
+
+  ITK_TRY_EXPECT_NO_EXCEPTION(statisticsFilter->Update());
+
+  ITK_TEST_EXPECT_EQUAL(0, statisticsFilter->GetOutput()->GetBufferedRegion().GetNumberOfPixels());
+
+  const std::vector<unsigned char> labels = statisticsFilter->GetLabels();
+  ITK_TEST_EXPECT_EQUAL(2, labels.size());
+  ITK_TEST_EXPECT_EQUAL(1, labels[0]);
+  ITK_TEST_EXPECT_EQUAL(2, labels[1]);
+  ITK_TRY_EXPECT_EXCEPTION(statisticsFilter->GetMean(0, 0));
+
+  // The statistics match the ones of the finite values of the feature map, for every label and feature
+  std::map<unsigned char, std::vector<std::vector<double>>> labelFeatureValues;
+  itk::ImageRegionConstIterator<OutputImageType>            featuresIt(filter->GetOutput(), region);
+  for (labelIt.GoToBegin(); !featuresIt.IsAtEnd(); ++featuresIt, ++labelIt)
+  {
+    if (labelIt.Get() == 0)
+    {
+      continue;
+    }
+    std::vector<std::vector<double>> & featureValues = labelFeatureValues[labelIt.Get()];
+    featureValues.resize(VectorComponentDimension);
+    for (unsigned int feature = 0; feature < VectorComponentDimension; ++feature)
+    {
+      if (std::isfinite(featuresIt.Get()[feature]))
+      {
+        featureValues[feature].push_back(featuresIt.Get()[feature]);
+      }
+    }
+  }
+
+  for (const unsigned char label : labels)
+  {
+    for (unsigned int feature = 0; feature < VectorComponentDimension; ++feature)
+    {
+      std::vector<double> & values = labelFeatureValues[label][feature];
+      ITK_TEST_EXPECT_EQUAL(values.size(), statisticsFilter->GetCount(label, feature));
+      if (values.size() < 2)
+      {
+        continue;
+      }
+
+      double sum = 0;
+      for (const double value : values)
+      {
+        sum += value;
+      }
+      const double mean = sum / values.size();
+      double       sumOfSquaredDeviations = 0;
+      for (const double value : values)
+      {
+        sumOfSquaredDeviations += (value - mean) * (value - mean);
+      }
+      const double sigma = std::sqrt(sumOfSquaredDeviations / (values.size() - 1));
+
+      ITK_TEST_EXPECT_TRUE(itk::Math::abs(statisticsFilter->GetMean(label, feature) - mean) <=
+                           1e-9 * itk::Math::abs(mean));
+      ITK_TEST_EXPECT_TRUE(itk::Math::abs(statisticsFilter->GetSigma(label, feature) - sigma) <= 1e-6 * sigma);
+      ITK_TEST_EXPECT_EQUAL(*std::min_element(values.begin(), values.end()),
+                            statisticsFilter->GetMinimum(label, feature));
+      ITK_TEST_EXPECT_EQUAL(*std::max_element(values.begin(), values.end()),
+                            statisticsFilter->GetMaximum(label, feature));
+
+      std::sort(values.begin(), values.end());
+      for (const double p : { 0.05, 0.5, 0.95 })
+      {
+        const double quantile = values[static_cast<size_t>(p * (values.size() - 1))];
+        ITK_TEST_EXPECT_TRUE(itk::Math::abs(statisticsFilter->GetQuantile(label, feature, p) - quantile) <=
+                             quantileRelativeAccuracy * (1.0 + 1e-6) * itk::Math::abs(quantile));
+      }
+      ITK_TEST_EXPECT_EQUAL(statisticsFilter->GetQuantile(label, feature, 0.5),
+                            statisticsFilter->GetMedian(label, feature));
+    }
+  }
+
+  // Updating again without modification does not recompute the statistics
+  const itk::ModifiedTimeType statisticsUpdateTime = statisticsFilter->GetOutput()->GetUpdateMTime();
+  ITK_TRY_EXPECT_NO_EXCEPTION(statisticsFilter->Update());
+  ITK_TEST_EXPECT_EQUAL(statisticsUpdateTime, statisticsFilter->GetOutput()->GetUpdateMTime());
+  ITK_TEST_EXPECT_EQUAL(2, statisticsFilter->GetLabels().size());
+
+  // Without bone voxels, the trabecular thickness has no finite value and all its statistics are NaN
+  const InputImageType::SizeType noBoneSize = { { 8, 8, 8 } };
+  auto                           noBoneImage = InputImageType::New();
+  noBoneImage->SetRegions(noBoneSize);
+  noBoneImage->Allocate();
+  noBoneImage->FillBuffer(0);
+  auto noBoneLabelImage = LabelImageType::New();
+  noBoneLabelImage->SetRegions(noBoneSize);
+  noBoneLabelImage->Allocate();
+  noBoneLabelImage->FillBuffer(3);
+
+  auto noBoneFilter = StatisticsFilterType::New();
+  noBoneFilter->SetInput(noBoneImage);
+  noBoneFilter->SetLabelImage(noBoneLabelImage);
+  noBoneFilter->SetThreshold(1300);
+  noBoneFilter->ReduceOnlyOn();
+  ITK_TRY_EXPECT_NO_EXCEPTION(noBoneFilter->Update());
+
+  ITK_TEST_EXPECT_EQUAL(noBoneSize[0] * noBoneSize[1] * noBoneSize[2], noBoneFilter->GetCount(3, 0));
+  ITK_TEST_EXPECT_EQUAL(0, noBoneFilter->GetMinimum(3, 0));
+  ITK_TEST_EXPECT_EQUAL(0, noBoneFilter->GetMaximum(3, 0));
+  ITK_TEST_EXPECT_EQUAL(0, noBoneFilter->GetCount(3, 2));
+  ITK_TEST_EXPECT_TRUE(std::isnan(noBoneFilter->GetMean(3, 2)));
+  ITK_TEST_EXPECT_TRUE(std::isnan(noBoneFilter->GetSigma(3, 2)));
+  ITK_TEST_EXPECT_TRUE(std::isnan(noBoneFilter->GetMinimum(3, 2)));
+  ITK_TEST_EXPECT_TRUE(std::isnan(noBoneFilter->GetMaximum(3, 2)));
+  ITK_TEST_EXPECT_TRUE(std::isnan(noBoneFilter->GetMedian(3, 2)));
+
+  // The statistics do not outlive the update computing them
+  statisticsFilter->ReduceOnlyOff();
+  ITK_TRY_EXPECT_NO_EXCEPTION(statisticsFilter->Update());
+  ITK_TEST_EXPECT_TRUE(statisticsFilter->GetLabels().empty());
+
   std::cout << "Test finished." << std::endl;
   return EXIT_SUCCESS;
 }